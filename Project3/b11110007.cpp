@@ -31,6 +31,12 @@ public:
     // {("S1", "S2"): { (input, output), (input, output), ... }}
     map<string, vector<string>> dotMap;
 
+    // for incremental mode
+    // { state: class id }, states with the same class id are equivalent
+    map<string, int> partition;
+    // states whose transitions are added/changed/removed by the delta
+    set<string> editedStates;
+
     bool checkOutput(string state1, string state2) {
         // compare all output, all the same  then return true
         for (size_t i=0; i<infoMap[state1].size(); i++) {
@@ -187,6 +193,493 @@ public:
         }
     }
 
+    // build partition from implicationMap after simplify() is done
+    // every state joins the class of the first state (in varName order) it is equivalent to
+    void buildPartition() {
+        partition.clear();
+        for (size_t j=0; j<varName.size(); j++) {
+            partition[varName[j]] = j;
+            for (size_t i=0; i<j; i++) {
+                if (get<0>(implicationMap[varName[i]][varName[j]][0]) != "-") {
+                    partition[varName[j]] = partition[varName[i]];
+                    break;
+                }
+            }
+        }
+    }
+
+    // one class per line, ex: "a c f", states are in varName order
+    void writePartition(string fileName) {
+        map<int, vector<string>> classes;
+        vector<int> order;
+        for (string& name: varName) {
+            int id = partition[name];
+            if (classes.find(id) == classes.end()) order.push_back(id);
+            classes[id].push_back(name);
+        }
+
+        ofstream out(fileName);
+        out << ".partition " << order.size() << '\n';
+        for (int id: order) {
+            out << classes[id][0];
+            for (size_t i=1; i<classes[id].size(); i++) {
+                out << " " << classes[id][i];
+            }
+            out << '\n';
+        }
+        out << ".end";
+        out.close();
+    }
+
+    // read a partition written by writePartition()
+    // return false if it does not list every state once or does not belong to the input STG
+    bool readPartition(string fileName) {
+        fstream f(fileName);
+        string line;
+        int id = 0;
+        partition.clear();
+
+        if (!f.is_open()) {
+            cerr << "cannot open " << fileName << endl;
+            return false;
+        }
+
+        while (getline(f, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty() || line[0] == '.') continue;
+
+            for (string name: split(line, ' ')) {
+                if (infoMap.find(name) == infoMap.end() || partition.find(name) != partition.end()) {
+                    cerr << "state " << name << " is unknown or listed twice in " << fileName << endl;
+                    return false;
+                }
+                partition[name] = id;
+            }
+            id++;
+        }
+
+        for (string& name: varName) {
+            if (partition.find(name) == partition.end()) {
+                cerr << "state " << name << " is not in " << fileName << endl;
+                return false;
+            }
+        }
+
+        // states of one class must have the same outputs and go to the same classes,
+        // otherwise the file was saved for another STG
+        map<int, string> first;
+        for (string& name: varName) {
+            int c = partition[name];
+            if (first.find(c) == first.end()) {
+                first[c] = name;
+                continue;
+            }
+
+            for (size_t in=0; in<infoMap[name].size(); in++) {
+                auto& t1 = infoMap[first[c]][in];
+                auto& t2 = infoMap[name][in];
+                if (get<1>(t1) != get<1>(t2) || partition[get<0>(t1)] != partition[get<0>(t2)]) {
+                    cerr << "states " << first[c] << " and " << name << " are not equivalent, "
+                         << fileName << " does not belong to this STG" << endl;
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // apply the edited transitions to infoMap, every line is one of
+    //   ~ in cur next out   (change a transition)
+    //   + in cur next out   (add a transition to an empty slot, a new state is added when cur is unknown)
+    //   - in cur            (remove a transition, all transitions of a state must be removed together)
+    // return false if a line is wrong or the STG is not completely specified afterwards
+    bool applyDelta(string fileName) {
+        fstream f(fileName);
+        string line;
+
+        if (infoMap.empty()) {
+            cerr << "the input STG has no state" << endl;
+            return false;
+        }
+        size_t inputCount = infoMap.begin()->second.size();
+
+        if (!f.is_open()) {
+            cerr << "cannot open " << fileName << endl;
+            return false;
+        }
+
+        while (getline(f, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty() || line[0] == '.') continue;
+
+            vector<string> elements = split(line, ' ');  // [op, in, cur, (next, out)]
+            if (elements.empty()) continue;  // only spaces
+
+            string op = elements[0];
+            bool isValid = (op == "-" && elements.size() == 3) || ((op == "~" || op == "+") && elements.size() == 5);
+            if (isValid) {
+                isValid = elements[1].size() < 31 && elements[1].find_first_not_of("01") == string::npos
+                    && biToDe(elements[1]) < (int)inputCount;
+            }
+            if (isValid && op != "+") {  // only "+" may add a new state
+                isValid = infoMap.find(elements[2]) != infoMap.end();
+            }
+            if (isValid && op == "+" && infoMap.find(elements[2]) != infoMap.end()) {  // "+" never overwrites
+                size_t in = biToDe(elements[1]);
+                isValid = infoMap[elements[2]].size() <= in || get<0>(infoMap[elements[2]][in]) == "-";
+            }
+            if (!isValid) {
+                cerr << "wrong line in " << fileName << ": " << line << endl;
+                return false;
+            }
+
+            size_t in = biToDe(elements[1]);
+            string cur = elements[2];
+
+            if (infoMap.find(cur) == infoMap.end()) {
+                varName.push_back(cur);
+                partition[cur] = -(int)varName.size();  // not equivalent to any old state yet
+            }
+            if (infoMap[cur].size() <= in) {
+                infoMap[cur].resize(in + 1, { "-", "-" });
+            }
+
+            if (op == "-") {
+                infoMap[cur][in] = { "-", "-" };
+            }
+            else {
+                infoMap[cur][in] = { elements[3], elements[4] };
+            }
+            editedStates.insert(cur);
+        }
+
+        // remove the states without any transition
+        for (string name: editedStates) {
+            bool isEmpty = true;
+            for (auto& t: infoMap[name]) {
+                if (get<0>(t) != "-") isEmpty = false;
+            }
+            if (isEmpty) {
+                infoMap.erase(name);
+                partition.erase(name);
+                varName.erase(find(varName.begin(), varName.end(), name));
+            }
+        }
+
+        if (infoMap.empty()) {
+            cerr << "the delta removes every state" << endl;
+            return false;
+        }
+
+        for (auto it = infoMap.begin(); it != infoMap.end(); ++it) {
+            if (it->second.size() != inputCount) {
+                cerr << "state " << it->first << " does not have " << inputCount << " transitions" << endl;
+                return false;
+            }
+            for (auto& t: it->second) {
+                if (get<0>(t) == "-") {
+                    cerr << "state " << it->first << " is not completely specified, "
+                         << "a state can only lose all of its transitions at once" << endl;
+                    return false;
+                }
+                if (infoMap.find(get<0>(t)) == infoMap.end()) {
+                    cerr << "state " << it->first << " has an unknown next state " << get<0>(t) << endl;
+                    return false;
+                }
+            }
+        }
+
+        inputNumLen = varName.size() * inputCount;
+        return true;
+    }
+
+    // incremental version of initImpliMap() + simplify()
+    // first split the classes touched by the delta until the partition is stable again,
+    // then merge the classes that can reach an edited state with the classes of the same behavior
+    void updatePartition() {
+        size_t n = varName.size();
+        size_t inputCount = infoMap[varName[0]].size();
+        map<string, int> index;
+        for (size_t s=0; s<n; s++) {
+            index[varName[s]] = s;
+        }
+
+        // next[s][in], out[s][in] and the reversed transitions
+        vector<vector<int>> next(n, vector<int>(inputCount));
+        vector<vector<string>> out(n, vector<string>(inputCount));
+        vector<vector<int>> prev(n);
+        for (size_t s=0; s<n; s++) {
+            for (size_t in=0; in<inputCount; in++) {
+                next[s][in] = index[get<0>(infoMap[varName[s]][in])];
+                out[s][in] = get<1>(infoMap[varName[s]][in]);
+                prev[next[s][in]].push_back(s);
+            }
+        }
+
+        // renumber the classes to 0, 1, 2, ...
+        vector<int> cls(n);
+        vector<vector<int>> members;
+        map<int, int> renumber;
+        for (size_t s=0; s<n; s++) {
+            int id = partition[varName[s]];
+            if (renumber.find(id) == renumber.end()) {
+                renumber[id] = members.size();
+                members.push_back(vector<int>());
+            }
+            cls[s] = renumber[id];
+            members[cls[s]].push_back(s);
+        }
+
+        // split: a class is checked again when one of its states is edited or one of its next states moved
+        vector<int> work;
+        vector<bool> inWork(members.size(), false);
+        for (const string& name: editedStates) {
+            if (index.find(name) == index.end()) continue;
+            int c = cls[index[name]];
+            if (!inWork[c]) {
+                inWork[c] = true;
+                work.push_back(c);
+            }
+        }
+
+        while (!work.empty()) {
+            int c = work.back();
+            work.pop_back();
+            inWork[c] = false;
+
+            // group the states of class c by their outputs and the classes of their next states
+            map<string, vector<int>> groups;
+            for (int s: members[c]) {
+                string key;
+                for (size_t in=0; in<inputCount; in++) {
+                    key += out[s][in] + "/" + to_string(cls[next[s][in]]) + ",";
+                }
+                groups[key].push_back(s);
+            }
+            if (groups.size() == 1) continue;
+
+            // the biggest group keeps the class id, the others move to new classes
+            auto biggest = groups.begin();
+            for (auto it = groups.begin(); it != groups.end(); ++it) {
+                if (it->second.size() > biggest->second.size()) biggest = it;
+            }
+            members[c] = biggest->second;
+
+            vector<int> moved;
+            for (auto it = groups.begin(); it != groups.end(); ++it) {
+                if (it == biggest) continue;
+
+                int newCls = members.size();
+                members.push_back(it->second);
+                inWork.push_back(false);
+                for (int s: it->second) {
+                    cls[s] = newCls;
+                    moved.push_back(s);
+                }
+            }
+
+            // queue the predecessors only after every group has its class id,
+            // otherwise a predecessor in class c would be queued with its old id
+            for (int s: moved) {
+                for (int p: prev[s]) {
+                    if (!inWork[cls[p]]) {
+                        inWork[cls[p]] = true;
+                        work.push_back(cls[p]);
+                    }
+                }
+            }
+        }
+
+        // quotient machine of the stable partition
+        size_t classNum = members.size();
+        vector<vector<int>> qNext(classNum, vector<int>(inputCount));
+        vector<vector<string>> qOut(classNum, vector<string>(inputCount));
+        vector<vector<int>> qPrev(classNum);
+        for (size_t c=0; c<classNum; c++) {
+            int s = members[c][0];
+            for (size_t in=0; in<inputCount; in++) {
+                qNext[c][in] = cls[next[s][in]];
+                qOut[c][in] = out[s][in];
+                qPrev[qNext[c][in]].push_back(c);
+            }
+        }
+
+        // only a class that can reach an edited state may become equivalent to another class
+        vector<bool> affected(classNum, false);
+        for (const string& name: editedStates) {
+            if (index.find(name) == index.end()) continue;
+            int c = cls[index[name]];
+            if (!affected[c]) {
+                affected[c] = true;
+                work.push_back(c);
+            }
+        }
+        while (!work.empty()) {
+            int c = work.back();
+            work.pop_back();
+            for (int p: qPrev[c]) {
+                if (!affected[p]) {
+                    affected[p] = true;
+                    work.push_back(p);
+                }
+            }
+        }
+
+        // a class that can not reach an edited state keeps its behavior, so two such classes stay
+        // different, only the affected classes and the classes with the same outputs may be merged
+        set<string> affectedOutputs;
+        for (size_t c=0; c<classNum; c++) {
+            if (affected[c]) affectedOutputs.insert(outputKey(qOut[c]));
+        }
+
+        // candidates and all the classes they can reach, equivalence inside this set
+        // does not depend on any class outside of it
+        vector<int> sId(classNum, -1);
+        vector<int> sClass;
+        for (size_t c=0; c<classNum; c++) {
+            if (affected[c] || affectedOutputs.count(outputKey(qOut[c]))) {
+                sId[c] = sClass.size();
+                sClass.push_back(c);
+                work.push_back(c);
+            }
+        }
+        while (!work.empty()) {
+            int c = work.back();
+            work.pop_back();
+            for (size_t in=0; in<inputCount; in++) {
+                int d = qNext[c][in];
+                if (sId[d] == -1) {
+                    sId[d] = sClass.size();
+                    sClass.push_back(d);
+                    work.push_back(d);
+                }
+            }
+        }
+
+        // merge: Hopcroft's algorithm on the candidates, starting from one block per output
+        // elems[first[b]..last[b]) are the classes in block b
+        size_t m = sClass.size();
+        vector<vector<vector<int>>> inverse(inputCount, vector<vector<int>>(m));
+        for (size_t i=0; i<m; i++) {
+            for (size_t in=0; in<inputCount; in++) {
+                inverse[in][sId[qNext[sClass[i]][in]]].push_back(i);
+            }
+        }
+
+        map<string, vector<int>> byOutput;
+        for (size_t i=0; i<m; i++) {
+            byOutput[outputKey(qOut[sClass[i]])].push_back(i);
+        }
+        vector<int> elems, pos(m), blk(m), first, last, marked;
+        for (auto it = byOutput.begin(); it != byOutput.end(); ++it) {
+            first.push_back(elems.size());
+            for (int i: it->second) {
+                pos[i] = elems.size();
+                blk[i] = first.size() - 1;
+                elems.push_back(i);
+            }
+            last.push_back(elems.size());
+            marked.push_back(0);
+        }
+
+        vector<tuple<int, int>> splitters;  // (block, input)
+        vector<bool> inSplitters;           // index is block * inputCount + input
+        for (size_t b=0; b<first.size(); b++) {
+            for (size_t in=0; in<inputCount; in++) {
+                splitters.push_back({ b, in });
+                inSplitters.push_back(true);
+            }
+        }
+
+        while (!splitters.empty()) {
+            int a = get<0>(splitters.back());
+            int in = get<1>(splitters.back());
+            splitters.pop_back();
+            inSplitters[a * inputCount + in] = false;
+
+            // mark the classes going to block a with this input, marked ones move to the front of their block
+            vector<int> pred, touched;
+            for (int p=first[a]; p<last[a]; p++) {
+                pred.insert(pred.end(), inverse[in][elems[p]].begin(), inverse[in][elems[p]].end());
+            }
+            for (int i: pred) {
+                int b = blk[i];
+                if (marked[b] == 0) touched.push_back(b);
+                int j = elems[first[b] + marked[b]];
+                swap(elems[pos[i]], elems[first[b] + marked[b]]);
+                swap(pos[i], pos[j]);
+                marked[b]++;
+            }
+
+            // split every block that is only partly marked
+            for (int b: touched) {
+                if (marked[b] == last[b] - first[b]) {
+                    marked[b] = 0;
+                    continue;
+                }
+
+                int nb = first.size();
+                first.push_back(first[b]);
+                last.push_back(first[b] + marked[b]);
+                marked.push_back(0);
+                first[b] = last[nb];
+                marked[b] = 0;
+                for (int p=first[nb]; p<last[nb]; p++) {
+                    blk[elems[p]] = nb;
+                }
+
+                for (size_t c=0; c<inputCount; c++) {
+                    inSplitters.push_back(false);
+                    if (inSplitters[b * inputCount + c] || last[nb] - first[nb] <= last[b] - first[b]) {
+                        splitters.push_back({ nb, c });
+                        inSplitters[nb * inputCount + c] = true;
+                    }
+                    else {
+                        splitters.push_back({ b, c });
+                        inSplitters[b * inputCount + c] = true;
+                    }
+                }
+            }
+        }
+
+        // classes outside the candidates keep their own id
+        partition.clear();
+        for (size_t s=0; s<n; s++) {
+            int c = cls[s];
+            partition[varName[s]] = (sId[c] == -1) ? c : classNum + blk[sId[c]];
+        }
+    }
+
+    // all outputs of one state or class, ex: "0,1,"
+    string outputKey(const vector<string>& outputs) {
+        string key;
+        for (const string& o: outputs) {
+            key += o + ",";
+        }
+        return key;
+    }
+
+    // incremental version of replace(): keep the first state (in varName order) of every class
+    void replaceByPartition() {
+        map<int, string> represent;
+        for (string& name: varName) {
+            if (represent.find(partition[name]) == represent.end()) {
+                represent[partition[name]] = name;
+            }
+        }
+
+        for (string& name: varName) {
+            if (represent[partition[name]] != name) {
+                infoMap.erase(name);
+            }
+        }
+        for (auto it = infoMap.begin(); it != infoMap.end(); ++it) {
+            for (auto& t: it->second) {
+                get<0>(t) = represent[partition[get<0>(t)]];
+            }
+        }
+    }
+
     void writeKiss(string fileName) {
         ofstream  out(fileName);
         out << ".start_kiss\n.i 1\n.o 1\n.p " << outputLen << '\n';
@@ -331,8 +824,11 @@ private:
 
 int main(int argc, char** argv) {
     string inputFile, outputKiss, outputDot;
-    if (argc < 3) {
-        cerr << "Usage: " << argv[0] << " <input file> <output file>\n";
+    string partitionFile, deltaFile, savePartitionFile;
+    string usage = string("Usage: ") + argv[0] + " <input file> <output kiss> <output dot>"
+                   + " [--partition <file> --delta <file>] [--save-partition <file>]\n";
+    if (argc < 4) {
+        cerr << usage;
         return 1;
     }
 
@@ -340,17 +836,47 @@ int main(int argc, char** argv) {
     outputKiss = argv[2];
     outputDot = argv[3];
 
+    for (int i=4; i<argc; i++) {
+        string option = argv[i];
+        if (i+1 < argc && option == "--partition") partitionFile = argv[++i];
+        else if (i+1 < argc && option == "--delta") deltaFile = argv[++i];
+        else if (i+1 < argc && option == "--save-partition") savePartitionFile = argv[++i];
+        else {
+            cerr << usage;
+            return 1;
+        }
+    }
+
+    // the incremental mode needs both files
+    if ((partitionFile == "") != (deltaFile == "")) {
+        cerr << usage;
+        return 1;
+    }
+
     State state;
 
     state.readFile(inputFile);
-    state.initImpliMap();
 
-    bool keepSimplfy = state.simplify();
-    while (keepSimplfy) {
-        keepSimplfy = state.simplify();
+    if (partitionFile != "" && deltaFile != "") {
+        // incremental mode: start from the saved partition of inputFile and apply the delta
+        if (!state.readPartition(partitionFile) || !state.applyDelta(deltaFile)) {
+            return 1;
+        }
+        state.updatePartition();
+        state.replaceByPartition();
     }
+    else {
+        state.initImpliMap();
 
-    state.replace();
+        bool keepSimplfy = state.simplify();
+        while (keepSimplfy) {
+            keepSimplfy = state.simplify();
+        }
+
+        if (savePartitionFile != "") state.buildPartition();
+
+        state.replace();
+    }
 
     state.printInfoMap();
 
@@ -358,4 +884,6 @@ int main(int argc, char** argv) {
 
     state.writeKiss(outputKiss);
     state.writeDot(outputDot);
+
+    if (savePartitionFile != "") state.writePartition(savePartitionFile);
 }
\ No newline at end of file
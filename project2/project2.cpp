@@ -6,9 +6,116 @@
 #include <set>
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <bitset>
 
 using namespace std;
 
+// packed implicant used by the out-of-core mode (--mem-limit)
+// bit k of dash is set when literal k is '-', bit k of value is set when literal k is '1'
+struct Cube {
+    uint64_t value = 0;
+    uint64_t dash = 0;
+    vector<int> minterms;  // sorted minterms covered by the implicant
+
+    int weight() const {
+        return bitset<64>(value).count();
+    }
+
+    // cubes are ordered by group first, so a level file is read group by group
+    bool operator<(const Cube& other) const {
+        if (weight() != other.weight()) return weight() < other.weight();
+        if (dash != other.dash) return dash < other.dash;
+        return value < other.value;
+    }
+
+    bool sameKey(const Cube& other) const {
+        return value == other.value && dash == other.dash;
+    }
+};
+
+// this function writes one cube to a binary run file, return false if the write failed
+bool writeCube(ofstream& out, const Cube& c) {
+    uint32_t n = c.minterms.size();
+    out.write((const char*)&c.value, sizeof(c.value));
+    out.write((const char*)&c.dash, sizeof(c.dash));
+    out.write((const char*)&n, sizeof(n));
+    out.write((const char*)c.minterms.data(), n * sizeof(int));
+    return bool(out);
+}
+
+// this function reads one cube from a binary run file, return false at the end of file
+// a cube that is cut in the middle sets badbit, so the caller can tell it from the end of file
+bool readCube(ifstream& in, Cube& c) {
+    uint32_t n = 0;
+    if (!in.read((char*)&c.value, sizeof(c.value))) {
+        if (in.gcount() != 0) in.setstate(ios::badbit);
+        return false;
+    }
+    in.read((char*)&c.dash, sizeof(c.dash));
+    in.read((char*)&n, sizeof(n));
+    if (in) {
+        c.minterms.resize(n);
+        in.read((char*)c.minterms.data(), n * sizeof(int));
+    }
+    if (!in) {
+        in.setstate(ios::badbit);
+        return false;
+    }
+    return true;
+}
+
+// this function adds all minterms of b into a, both are sorted
+void unionMinterms(vector<int>& a, const vector<int>& b) {
+    vector<int> result;
+    result.reserve(a.size() + b.size());
+    set_union(a.begin(), a.end(), b.begin(), b.end(), back_inserter(result));
+    a.swap(result);
+}
+
+// approximate memory used by one cube while it is held in a buffer
+size_t cubeBytes(const Cube& c) {
+    return sizeof(Cube) + c.minterms.size() * sizeof(int);
+}
+
+// this class reads the cubes of several files one file after another
+class CubeReader {
+public:
+    Cube cur;
+    bool valid = false;
+    bool failed = false;  // a file could not be opened or a cube is broken
+
+    CubeReader(vector<string> fileList) {
+        files = fileList;
+        next();
+    }
+
+    void next() {
+        while (true) {
+            if (in.is_open() && readCube(in, cur)) {
+                valid = true;
+                return;
+            }
+            if (in.is_open() && in.bad()) failed = true;
+            if (in.is_open()) in.close();
+            if (failed || index >= files.size()) {
+                valid = false;
+                return;
+            }
+            in.clear();
+            in.open(files[index++], ios::binary);
+            if (!in.is_open()) failed = true;
+        }
+    }
+
+private:
+    vector<string> files;
+    size_t index = 0;
+    ifstream in;
+};
+
 class Robdd {
 public:
     string inputFile, outputFile;
@@ -21,12 +128,21 @@ public:
     set<set<string>> disMap = set<set<string>>();  // used to implement distributive law
     map<int, set<string>> implicantsMap = map<int, set<string>>();  // {minterm: {all implicants containing the key minterm}}
     string outputLine;  // store the basic information of the input pla file
+    double memLimit = 0;  // in MB, 0 keeps every level in memory, otherwise levels are kept on disk
+    string tmpPrefix;     // prefix of the temporary files used when memLimit is set
+    int level = 0;        // current level of the out-of-core tabulation
+    int runId = 0;        // used to name the temporary run files
+    set<string> tmpFiles; // temporary files that still exist, removed when a disk error happens
+    vector<Cube> readBuf; // terms of level 0 not spilled yet, used instead of mintermMap & groupMap
+    size_t readBytes = 0;
+    vector<string> readRuns;
 
     // constructor
     Robdd(string in, string out) {
         inputFile = in;
         outputFile = out;
         varNum = 0;
+        tmpPrefix = out + ".qmtmp";
     }
 
 
@@ -45,8 +161,13 @@ public:
     // don't care will not be the input, ex. 00-1
     void findMinterm(string term, string ans, int index) {
         if (index == varNum) {  // all literals is added
-            mintermMap[ans] = { addInBinary(ans) };
-            grouping(ans);
+            if (memLimit > 0) {
+                bufferTerm(ans, { addInBinary(ans) });
+            }
+            else {
+                mintermMap[ans] = { addInBinary(ans) };
+                grouping(ans);
+            }
         }
         else { 
             if (term[index] == '-') {
@@ -71,13 +192,22 @@ public:
     }
 
     // after this excuting this function, grouping done
-    void readFile() {
+    // with memLimit the terms go to the read buffer and its runs instead, return false if there are too many variables
+    bool readFile() {
         fstream f(inputFile);
         string line;
         bool start = false;
         while (getline(f, line)) {
             if (!start) outputLine += (line + '\n');
-            if (line.find(".i") != string::npos && varNum == 0) varNum = stoi(line.substr(2));  // get varNum
+            if (line.find(".i") != string::npos && varNum == 0) {
+                varNum = stoi(line.substr(2));  // get varNum
+
+                // minterm numbers are int, check it before any term is expanded
+                if (memLimit > 0 && varNum > 31) {
+                    cerr << "--mem-limit supports at most 31 variables\n";
+                    return false;
+                }
+            }
             if (line.find(".ilb") != string::npos) varVec = split(line.substr(4), ' ');   // get varVec
             if (line.find(".e") != string::npos) start = false;
             
@@ -89,7 +219,12 @@ public:
                 if (line[line.size() - 1] == '-') {
                     findMinterm(term, "", 0);
                     dontcareMap[term] = addInBinary(term);
-                    grouping(term);
+                    if (memLimit > 0) {
+                        bufferTerm(term, {});
+                    }
+                    else {
+                        grouping(term);
+                    }
                 } 
                 else {
                     findMinterm(term, "", 0);
@@ -98,6 +233,8 @@ public:
 
             if (line.find(".p") != std::string::npos) start = true;
         }
+
+        return true;
     }
 
     // this function simplpified two implicants
@@ -173,6 +310,194 @@ public:
         return isSimplfied;
     }
 
+    // this function merges the runs written while reading the input into the first level,
+    // one sorted file per group
+    void spillLevel() {
+        spillRun(readBuf, readRuns);
+        readBytes = 0;
+
+        CubeReader reader(mergeRuns(readRuns));
+        vector<ofstream> out(varNum + 1);
+        for (int g=0; g<=varNum; g++) {
+            openTmp(out[g], levelFile(level, g));
+        }
+        while (reader.valid) {
+            if (!writeCube(out[reader.cur.weight()], reader.cur)) {
+                diskError("cannot write " + levelFile(level, reader.cur.weight()));
+            }
+            reader.next();
+        }
+        if (reader.failed) diskError("cannot read a run of " + tmpPrefix);
+        for (int g=0; g<=varNum; g++) {
+            closeTmp(out[g], levelFile(level, g));
+        }
+
+        for (string& file: readRuns) {
+            removeTmp(file);
+        }
+        readRuns.clear();
+    }
+
+    // out-of-core version of simplfy(), should be excuted until return value is false
+    // group i is loaded in chunks that fit in half of memLimit and group i+1 is streamed against it,
+    // the simplified and abandoned terms are spilled as sorted runs and merged into the next level
+    bool simplfyOnDisk() {
+        bool isSimplfied = false;
+        size_t budget = memBudget();
+        vector<Cube> simplifiedBuf, abandondBuf;
+        size_t simplifiedBytes = 0, abandondBytes = 0;
+        vector<string> simplifiedRuns, abandondRuns;
+
+        for (int i=0; i<varNum; i++) {
+            ifstream lower;
+            openTmp(lower, levelFile(level, i));
+            Cube c;
+            bool more = true;
+
+            while (more) {
+                // at least one cube is loaded even if it is bigger than the budget
+                vector<Cube> chunk;
+                size_t chunkBytes = 0;
+                while ((chunk.empty() || chunkBytes < budget / 2) && (more = readCube(lower, c))) {
+                    chunkBytes += cubeBytes(c);
+                    chunk.push_back(c);
+                }
+                if (lower.bad()) diskError("cannot read " + levelFile(level, i));
+                if (chunk.empty()) break;
+                vector<bool> used(chunk.size(), false);
+
+                ifstream upper;
+                openTmp(upper, levelFile(level, i+1));
+                Cube term2;
+                while (readCube(upper, term2)) {
+                    bool term2Used = false;
+
+                    for (size_t j=0; j<chunk.size(); j++) {
+                        // same as simplfyProcess(): exactly one literal may differ
+                        uint64_t diff = (chunk[j].dash ^ term2.dash) | (chunk[j].value ^ term2.value);
+                        if (diff == 0 || (diff & (diff - 1)) != 0) continue;
+
+                        Cube simplified;
+                        simplified.dash = chunk[j].dash | diff;
+                        simplified.value = chunk[j].value & ~diff;
+                        simplified.minterms = chunk[j].minterms;
+                        unionMinterms(simplified.minterms, term2.minterms);
+
+                        simplifiedBytes += cubeBytes(simplified);
+                        simplifiedBuf.push_back(simplified);
+                        if (simplifiedBytes >= budget / 4) {
+                            spillRun(simplifiedBuf, simplifiedRuns);
+                            simplifiedBytes = 0;
+                        }
+
+                        isSimplfied = true;
+                        used[j] = true;
+                        term2Used = true;
+                    }
+
+                    if (term2Used) {
+                        abandondBytes += addAbandond(abandondBuf, term2);
+                    }
+                    if (abandondBytes >= budget / 4) {
+                        spillRun(abandondBuf, abandondRuns);
+                        abandondBytes = 0;
+                    }
+                }
+                if (upper.bad()) diskError("cannot read " + levelFile(level, i+1));
+
+                for (size_t j=0; j<chunk.size(); j++) {
+                    if (used[j]) {
+                        abandondBytes += addAbandond(abandondBuf, chunk[j]);
+                    }
+                }
+                if (abandondBytes >= budget / 4) {
+                    spillRun(abandondBuf, abandondRuns);
+                    abandondBytes = 0;
+                }
+            }
+        }
+
+        if (!isSimplfied) {
+            return false;
+        }
+        spillRun(simplifiedBuf, simplifiedRuns);
+        spillRun(abandondBuf, abandondRuns);
+
+        // next level = (current level - abandond terms) + simplified terms
+        CubeReader old(levelFiles(level));
+        CubeReader add(mergeRuns(simplifiedRuns));
+        CubeReader drop(mergeRuns(abandondRuns));
+        vector<ofstream> next(varNum + 1);
+        for (int g=0; g<=varNum; g++) {
+            openTmp(next[g], levelFile(level+1, g));
+        }
+
+        while (old.valid || add.valid) {
+            Cube result;
+            if (!add.valid || (old.valid && !(add.cur < old.cur))) {
+                result.value = old.cur.value;
+                result.dash = old.cur.dash;
+            }
+            else {
+                result.value = add.cur.value;
+                result.dash = add.cur.dash;
+            }
+
+            while (drop.valid && drop.cur < result) drop.next();
+            bool isDropped = drop.valid && drop.cur.sameKey(result);
+            bool keep = false;
+
+            if (old.valid && old.cur.sameKey(result)) {
+                if (!isDropped) {
+                    result.minterms = old.cur.minterms;
+                    keep = true;
+                }
+                old.next();
+            }
+            if (add.valid && add.cur.sameKey(result)) {
+                unionMinterms(result.minterms, add.cur.minterms);
+                keep = true;
+                add.next();
+            }
+
+            if (keep && !writeCube(next[result.weight()], result)) {
+                diskError("cannot write " + levelFile(level+1, result.weight()));
+            }
+        }
+        if (old.failed || add.failed || drop.failed) diskError("cannot read level " + to_string(level));
+        for (int g=0; g<=varNum; g++) {
+            closeTmp(next[g], levelFile(level+1, g));
+        }
+
+        for (string& file: levelFiles(level)) {
+            removeTmp(file);
+        }
+        for (string& file: simplifiedRuns) {
+            removeTmp(file);
+        }
+        for (string& file: abandondRuns) {
+            removeTmp(file);
+        }
+        level++;
+
+        return true;
+    }
+
+    // this function reads the last level back into mintermMap and removes the level files
+    void loadLevel() {
+        for (string& file: levelFiles(level)) {
+            ifstream in;
+            openTmp(in, file);
+            Cube c;
+            while (readCube(in, c)) {
+                mintermMap[toTerm(c)] = set<int>(c.minterms.begin(), c.minterms.end());
+            }
+            if (in.bad()) diskError("cannot read " + file);
+            in.close();
+            removeTmp(file);
+        }
+    }
+
     // this funciton find essential prime implicant, update epi
     void findEPI() {
         map<int, string> minMap;  // the one with string is EPI, "" is not EPI
@@ -290,6 +615,174 @@ public:
     }
 
 private:
+    static const size_t maxFanIn = 16;  // maximum number of runs merged at once
+
+    // "01-" -> value 0b010, dash 0b100 (literal k is bit k)
+    Cube toCube(const string& term) {
+        Cube c;
+        for (int k=0; k<varNum; k++) {
+            if (term[k] == '1') c.value |= (uint64_t)1 << k;
+            if (term[k] == '-') c.dash |= (uint64_t)1 << k;
+        }
+        return c;
+    }
+
+    string toTerm(const Cube& c) {
+        string term(varNum, '0');
+        for (int k=0; k<varNum; k++) {
+            if ((c.value >> k) & 1) term[k] = '1';
+            if ((c.dash >> k) & 1) term[k] = '-';
+        }
+        return term;
+    }
+
+    string levelFile(int lv, int group) {
+        return tmpPrefix + ".level" + to_string(lv) + "_" + to_string(group);
+    }
+
+    vector<string> levelFiles(int lv) {
+        vector<string> files;
+        for (int g=0; g<=varNum; g++) {
+            files.push_back(levelFile(lv, g));
+        }
+        return files;
+    }
+
+    // open a temporary file, it is removed again by diskError() if anything fails later
+    void openTmp(ofstream& out, const string& file) {
+        tmpFiles.insert(file);
+        out.open(file, ios::binary);
+        if (!out.is_open()) diskError("cannot create " + file);
+    }
+
+    void openTmp(ifstream& in, const string& file) {
+        in.open(file, ios::binary);
+        if (!in.is_open()) diskError("cannot open " + file);
+    }
+
+    // data still in the buffer is written when closing, so the write may only fail here
+    void closeTmp(ofstream& out, const string& file) {
+        out.close();
+        if (out.fail()) diskError("cannot write " + file);
+    }
+
+    void removeTmp(const string& file) {
+        remove(file.c_str());
+        tmpFiles.erase(file);
+    }
+
+    // this function reports a failed temporary file, removes all temporary files and stops the program
+    void diskError(const string& message) {
+        cerr << "--mem-limit: " << message << endl;
+        for (const string& file: tmpFiles) {
+            remove(file.c_str());
+        }
+        exit(1);
+    }
+
+    size_t memBudget() {
+        return memLimit * 1024 * 1024;
+    }
+
+    // --mem-limit: add a term of level 0 to the read buffer, spill it as a run when it is full
+    void bufferTerm(const string& term, vector<int> minterms) {
+        Cube c = toCube(term);
+        c.minterms = minterms;
+        readBytes += cubeBytes(c);
+        readBuf.push_back(c);
+        if (readBytes >= memBudget() / 4) {
+            spillRun(readBuf, readRuns);
+            readBytes = 0;
+        }
+    }
+
+    // only the key of an abandond term is needed, return the bytes added to the buffer
+    size_t addAbandond(vector<Cube>& buffer, const Cube& term) {
+        Cube c;
+        c.value = term.value;
+        c.dash = term.dash;
+        buffer.push_back(c);
+        return cubeBytes(c);
+    }
+
+    // this function sorts the buffer, merges same terms and writes it as a new run file
+    void spillRun(vector<Cube>& buffer, vector<string>& runs) {
+        if (buffer.empty()) return;
+        sort(buffer.begin(), buffer.end());
+
+        string file = tmpPrefix + ".run" + to_string(runId++);
+        ofstream out;
+        openTmp(out, file);
+        size_t i = 0;
+        while (i < buffer.size()) {
+            Cube merged = buffer[i++];
+            while (i < buffer.size() && buffer[i].sameKey(merged)) {
+                unionMinterms(merged.minterms, buffer[i++].minterms);
+            }
+            if (!writeCube(out, merged)) diskError("cannot write " + file);
+        }
+        closeTmp(out, file);
+
+        runs.push_back(file);
+        buffer.clear();
+        vector<Cube>().swap(buffer);
+    }
+
+    // this function merges sorted runs until at most one run is left, then return it
+    vector<string>& mergeRuns(vector<string>& runs) {
+        while (runs.size() > 1) {
+            vector<string> merged;
+            for (size_t start=0; start<runs.size(); start+=maxFanIn) {
+                size_t end = (start + maxFanIn < runs.size()) ? start + maxFanIn : runs.size();
+                if (end - start == 1) {
+                    merged.push_back(runs[start]);
+                    continue;
+                }
+
+                vector<CubeReader> readers;
+                readers.reserve(end - start);
+                for (size_t i=start; i<end; i++) {
+                    readers.emplace_back(vector<string>{ runs[i] });
+                }
+
+                string file = tmpPrefix + ".run" + to_string(runId++);
+                ofstream out;
+                openTmp(out, file);
+                while (true) {
+                    // find the smallest term among all runs
+                    int minIndex = -1;
+                    for (size_t i=0; i<readers.size(); i++) {
+                        if (readers[i].valid && (minIndex == -1 || readers[i].cur < readers[minIndex].cur)) {
+                            minIndex = i;
+                        }
+                    }
+                    if (minIndex == -1) break;
+
+                    Cube result = readers[minIndex].cur;
+                    result.minterms.clear();
+                    for (CubeReader& reader: readers) {
+                        while (reader.valid && reader.cur.sameKey(result)) {
+                            unionMinterms(result.minterms, reader.cur.minterms);
+                            reader.next();
+                        }
+                    }
+                    if (!writeCube(out, result)) diskError("cannot write " + file);
+                }
+                for (CubeReader& reader: readers) {
+                    if (reader.failed) diskError("cannot read a run of " + tmpPrefix);
+                }
+                closeTmp(out, file);
+
+                for (size_t i=start; i<end; i++) {
+                    removeTmp(runs[i]);
+                }
+                merged.push_back(file);
+            }
+            runs = merged;
+        }
+
+        return runs;
+    }
 
     // This funciton return a vector of character(variables): "a b c" -> ['a', 'b', 'c']
     vector<string> split(string line, char del) {
@@ -310,8 +803,9 @@ private:
 int main(int argc, char** argv) {
     string inputFile, outputFile;
     set<string> finalAns;
+    string usage = string("Usage: ") + argv[0] + " <input file> <output file> [--mem-limit <MB>]\n";
     if (argc < 3) {
-        std::cerr << "Usage: " << argv[0] << " <input file> <output file>\n";
+        std::cerr << usage;
         return 1;
     }
 
@@ -319,13 +813,37 @@ int main(int argc, char** argv) {
     outputFile = argv[2];
 
     Robdd robddObj(inputFile, outputFile);
+
+    for (int i=3; i<argc; i++) {
+        // the limit must be a positive number of MB
+        char* end = nullptr;
+        if (string(argv[i]) != "--mem-limit" || i+1 >= argc
+            || !((robddObj.memLimit = strtod(argv[i+1], &end)) > 0) || !isfinite(robddObj.memLimit) || *end != '\0') {
+            std::cerr << usage;
+            return 1;
+        }
+        i++;
+    }
     
-    robddObj.readFile();
+    if (!robddObj.readFile()) {
+        return 1;
+    }
 
-    // this loop make sure the funciton is completely simplified
-    bool isSimplfied = robddObj.simplfy();
-    while (isSimplfied) {
-        isSimplfied = robddObj.simplfy();
+    if (robddObj.memLimit > 0) {
+        // same as below, but every level is kept on disk
+        robddObj.spillLevel();
+        bool isSimplfied = robddObj.simplfyOnDisk();
+        while (isSimplfied) {
+            isSimplfied = robddObj.simplfyOnDisk();
+        }
+        robddObj.loadLevel();
+    }
+    else {
+        // this loop make sure the funciton is completely simplified
+        bool isSimplfied = robddObj.simplfy();
+        while (isSimplfied) {
+            isSimplfied = robddObj.simplfy();
+        }
     }
 
     robddObj.findEPI();